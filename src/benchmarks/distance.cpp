@@ -0,0 +1,111 @@
+// Cost of verifying candidates: full distances versus distances that are abandoned
+// once they cannot beat the current kth best, with the coordinates in their original
+// order and sorted by decreasing variance.
+//
+// usage: benchmark_distance [points] [k]
+
+#include <iostream>
+#include <iomanip>
+#include <array>
+#include <vector>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+#include "topk.hpp"
+#include "distance.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+volatile double sink; // keeps the results alive
+
+template<typename F>
+double nsPerCandidate(size_t n, int repetitions, F verify) {
+  auto start = Clock::now();
+  for (int r = 0; r < repetitions; ++r) {
+    verify(r);
+  }
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / (n * repetitions);
+}
+
+template<size_t DIMS>
+void run(size_t n, size_t k) {
+  using Point = std::array<double, DIMS>;
+  std::mt19937 gen(DIMS);
+  std::normal_distribution<> dist(0, 1);
+  // every dimension gets its own scale, in random order
+  Point scale;
+  for (size_t d = 0; d < DIMS; ++d) {
+    scale[d] = 10.0 / (d + 1);
+  }
+  std::shuffle(scale.begin(), scale.end(), gen);
+  auto randomPoint = [&]{
+    Point p;
+    for (size_t d = 0; d < DIMS; ++d) {
+      p[d] = scale[d] * dist(gen);
+    }
+    return p;
+  };
+  std::vector<Point> points(n);
+  for (auto &p : points) {
+    p = randomPoint();
+  }
+  const int repetitions = 20;
+  std::vector<Point> queries(repetitions);
+  for (auto &q : queries) {
+    q = randomPoint();
+  }
+  std::vector<int> byVariance(DIMS);
+  std::iota(byVariance.begin(), byVariance.end(), 0);
+  std::sort(byVariance.begin(), byVariance.end(), [&scale](int a, int b){ return scale[a] > scale[b]; });
+  auto permute = [&byVariance](const Point &p){
+    Point q;
+    for (size_t d = 0; d < DIMS; ++d) {
+      q[d] = p[byVariance[d]];
+    }
+    return q;
+  };
+  std::vector<Point> permuted(n);
+  std::transform(points.begin(), points.end(), permuted.begin(), permute);
+
+  auto full = nsPerCandidate(n, repetitions, [&](int r){
+    topk::TopK<double, size_t> nearest{k};
+    for (size_t i = 0; i < n; ++i) {
+      nearest.push(distance::distSquared(points[i], queries[r]), i);
+    }
+    sink = nearest.bound();
+  });
+  auto bounded = nsPerCandidate(n, repetitions, [&](int r){
+    topk::TopK<double, size_t> nearest{k};
+    for (size_t i = 0; i < n; ++i) {
+      nearest.push(distance::distSquaredBounded(points[i], queries[r], nearest.bound()), i);
+    }
+    sink = nearest.bound();
+  });
+  auto sorted = nsPerCandidate(n, repetitions, [&](int r){
+    topk::TopK<double, size_t> nearest{k};
+    auto q = permute(queries[r]);
+    for (size_t i = 0; i < n; ++i) {
+      nearest.push(distance::distSquaredBounded(permuted[i], q, nearest.bound()), i);
+    }
+    sink = nearest.bound();
+  });
+  std::cout << std::fixed << std::setprecision(2)
+    << std::setw(6) << DIMS << std::setw(10) << full << std::setw(10) << bounded
+    << std::setw(10) << sorted << std::setw(10) << full / sorted << "x\n";
+}
+
+int main(int argc, char **argv) {
+  size_t n = argc > 1 ? std::atoi(argv[1]) : 20000;
+  size_t k = argc > 2 ? std::atoi(argv[2]) : 10;
+  std::cout << n << " candidates, k=" << k << ", ns per candidate\n";
+  std::cout << std::setw(6) << "dims" << std::setw(10) << "full" << std::setw(10) << "bounded"
+    << std::setw(10) << "sorted" << std::setw(11) << "speedup" << "\n";
+  run<16>(n, k);
+  run<32>(n, k);
+  run<64>(n, k);
+  run<128>(n, k);
+  run<256>(n, k);
+}
@@ -0,0 +1,79 @@
+// Latency versus throughput of single queries sent through the micro-batching executor.
+//
+// usage: benchmark_latency [max wait in us] [max batch size] [threads]
+
+#include <iostream>
+#include <iomanip>
+#include <array>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+
+#include "kdtree.hpp"
+#include "scheduler.hpp"
+
+constexpr kdtree::Size dims = 8;
+using Point = kdtree::Point<dims>;
+
+int main(int argc, char **argv) {
+  scheduler::Options options;
+  if (argc > 1) { options.maxWait = std::chrono::microseconds(std::atoi(argv[1])); }
+  if (argc > 2) { options.maxBatchSize = std::atoi(argv[2]); }
+  if (argc > 3) { options.threads = std::atoi(argv[3]); }
+  const int n = 20000;
+  const int k = 10;
+
+  std::mt19937 gen(1);
+  std::normal_distribution<> dist(0, 1);
+  std::vector<Point> points(n);
+  for (auto &p : points) {
+    for (auto &e : p) {
+      e = dist(gen);
+    }
+  }
+  std::vector<Point> queries(1000);
+  for (auto &p : queries) {
+    for (auto &e : p) {
+      e = dist(gen);
+    }
+  }
+  auto tree = kdtree::buildKdTree(points);
+  kdtree::printVisitedLeafes = false;
+
+  scheduler::Executor<Point, std::vector<kdtree::Neighbor>> executor{
+    [&tree, &points](const std::vector<Point> &batch){
+      std::vector<std::vector<kdtree::Neighbor>> results;
+      results.reserve(batch.size());
+      for (const auto &q : batch) {
+        results.push_back(kdtree::knnWithDistances(tree, points, k, q));
+      }
+      return results;
+    }, options};
+
+  // offered rates are chosen relative to the measured single thread capacity
+  auto start = scheduler::Clock::now();
+  for (int i = 0; i < 200; ++i) {
+    kdtree::knnWithDistances(tree, points, k, queries[i]);
+  }
+  auto capacity = options.threads * 200 / std::chrono::duration<double>(scheduler::Clock::now() - start).count();
+
+  std::cout << "kdtree, " << n << " points, " << dims << " dims, k=" << k
+    << ", max wait " << options.maxWait.count() << "us, max batch " << options.maxBatchSize
+    << ", " << options.threads << " threads, estimated capacity " << static_cast<int>(capacity) << "/s" << std::endl;
+  std::cout << std::setw(10) << "offered/s" << std::setw(12) << "achieved/s"
+    << std::setw(10) << "p50 us" << std::setw(10) << "p90 us" << std::setw(10) << "p99 us"
+    << std::setw(12) << "queue p99" << std::setw(12) << "service p99" << std::setw(8) << "batch" << "\n";
+  for (double load : {0.1, 0.25, 0.5, 0.75, 0.9, 1.0, 1.2}) {
+    auto rate = load * capacity;
+    executor.resetStats();
+    auto result = scheduler::runLoad(executor, queries, 8, rate, std::chrono::milliseconds(1000));
+    auto report = executor.report();
+    std::cout << std::fixed << std::setprecision(0)
+      << std::setw(10) << rate << std::setw(12) << result.throughput
+      << std::setw(10) << result.latency.p50 << std::setw(10) << result.latency.p90
+      << std::setw(10) << result.latency.p99 << std::setw(12) << report.queue.p99
+      << std::setw(12) << report.service.p99
+      << std::setw(8) << std::setprecision(1) << report.meanBatchSize << std::endl;
+  }
+}
@@ -0,0 +1,105 @@
+// LSH query time, verification time and exact distances per query with and without the
+// sketch prefilter, on points with a low intrinsic dimension. Verification is timed on
+// the same candidate lists; the rest of a query is collecting the candidates from the buckets.
+//
+// usage: benchmark_lsh [points] [prefilter]
+
+#include <iostream>
+#include <iomanip>
+#include <array>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+#include "lsh.hpp"
+#include "tests/common.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+constexpr Size dims = 128;
+constexpr Size K = 2;
+constexpr Size BITS = 256;
+
+int main(int argc, char **argv) {
+  int n = argc > 1 ? std::atoi(argv[1]) : 20000;
+  Real prefilter = argc > 2 ? std::atof(argv[2]) : 0.1;
+  const Size k = 10;
+  const Real r = 40;
+  const Size L = 10;
+  const int queries = 200;
+
+  std::mt19937 gen(1);
+  auto points = gen_low_rank_points<dims>(n, 8, 0.1, gen);
+  auto built = lsh::generate_hashes_with_sketches<dims, K, BITS>(points, r, L);
+  // both copies, so that the buckets of both have the same memory layout
+  auto index = built;
+  auto hashes = std::make_tuple(get<0>(built), get<1>(built));
+
+  auto micros = [](Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count() / queries;
+  };
+
+  std::vector<std::vector<Size>> unfiltered(queries);
+  Size exactUnfiltered = 0;
+  auto start = Clock::now();
+  for (int i = 0; i < queries; ++i) {
+    unfiltered[i] = lsh::knn<dims, K>(hashes, points, points[i], r, k);
+    exactUnfiltered += lsh::countExactDistances;
+  }
+  auto timeUnfiltered = micros(start);
+
+  Size exactFiltered = 0;
+  Size found = 0;
+  Size total = 0;
+  std::vector<std::vector<Size>> filtered(queries);
+  start = Clock::now();
+  for (int i = 0; i < queries; ++i) {
+    filtered[i] = lsh::knn<dims, K, BITS>(index, points, points[i], r, k, prefilter);
+    exactFiltered += lsh::countExactDistances;
+  }
+  auto timeFiltered = micros(start);
+
+  std::vector<std::vector<Size>> candidates(queries);
+  start = Clock::now();
+  for (int i = 0; i < queries; ++i) {
+    candidates[i] = lsh::candidates(get<0>(index), get<1>(index), points[i], r);
+  }
+  auto timeCandidates = micros(start);
+  double sink = 0;
+  start = Clock::now();
+  for (int i = 0; i < queries; ++i) {
+    sink += lsh::verify(points, points[i], candidates[i], k).back().dist;
+  }
+  auto verifyUnfiltered = micros(start);
+  start = Clock::now();
+  for (int i = 0; i < queries; ++i) {
+    const auto &sketches = get<2>(index);
+    sink += lsh::verify(points, points[i], candidates[i], k,
+      sketches, lsh::eval_sketch(sketches, points[i]), prefilter).back().dist;
+  }
+  auto verifyFiltered = micros(start);
+
+  for (int i = 0; i < queries; ++i) {
+    std::sort(unfiltered[i].begin(), unfiltered[i].end());
+    std::sort(filtered[i].begin(), filtered[i].end());
+    std::vector<Size> both;
+    std::set_intersection(unfiltered[i].begin(), unfiltered[i].end(),
+      filtered[i].begin(), filtered[i].end(), std::back_inserter(both));
+    found += both.size();
+    total += unfiltered[i].size();
+  }
+
+  std::cout << n << " points, " << dims << " dims, k=" << k << ", " << BITS << " bit sketches, "
+    << std::fixed << std::setprecision(2) << timeCandidates << "us/query collecting candidates"
+    << (sink < 0 ? "!" : "") << "\n";
+  std::cout << std::setw(12) << "prefilter" << std::setw(14) << "exact/query"
+    << std::setw(14) << "verify us" << std::setw(14) << "query us" << std::setw(10) << "recall" << "\n";
+  std::cout
+    << std::setw(12) << "none" << std::setw(14) << static_cast<double>(exactUnfiltered) / queries
+    << std::setw(14) << verifyUnfiltered << std::setw(14) << timeUnfiltered << std::setw(10) << 1.0 << "\n"
+    << std::setw(12) << prefilter << std::setw(14) << static_cast<double>(exactFiltered) / queries
+    << std::setw(14) << verifyFiltered << std::setw(14) << timeFiltered
+    << std::setw(10) << static_cast<double>(found) / total << "\n";
+}
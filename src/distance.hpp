@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <limits>
+#include <cstddef>
+
+namespace distance {
+
+using std::array;
+using std::size_t;
+
+// independent partial sums (one vector register), so that the summation vectorizes
+// without reassociating floating point adds
+constexpr size_t lanes = 4;
+// number of dimensions summed up between two checks against the bound
+constexpr size_t blockSize = 4 * lanes;
+
+template<typename Real>
+inline Real square(Real v) { return v * v; }
+
+template<typename Real>
+inline Real laneSum(const Real (&acc)[lanes]) {
+  Real d = 0;
+  for (size_t l = 0; l < lanes; ++l) {
+    d += acc[l];
+  }
+  return d;
+}
+
+// Squared distance of two points with DIMS coordinates that stops as soon as the partial sum reaches `bound`.
+// If the distance is smaller than `bound` the exact distance is returned,
+// otherwise some value `>= bound` (a lower bound of the exact distance).
+// The bound is only checked after every block of `blockSize` dimensions.
+template<size_t DIMS, typename Real>
+Real distSquaredBounded(const Real *p1, const Real *p2, Real bound) {
+  Real acc[lanes] = {};
+  size_t i = 0;
+  for (; i + blockSize <= DIMS; i += blockSize) {
+    for (size_t j = i; j < i + blockSize; j += lanes) {
+#pragma omp simd
+      for (size_t l = 0; l < lanes; ++l) {
+        acc[l] += square(p1[j + l] - p2[j + l]);
+      }
+    }
+    auto d = laneSum(acc);
+    if (d >= bound) {
+      return d;
+    }
+  }
+  auto d = laneSum(acc);
+  for (; i < DIMS; ++i) {
+    d += square(p1[i] - p2[i]);
+  }
+  return d;
+}
+
+template<typename Real, size_t DIMS>
+Real distSquaredBounded(const array<Real, DIMS> &p1, const array<Real, DIMS> &p2, Real bound) {
+  return distSquaredBounded<DIMS>(p1.data(), p2.data(), bound);
+}
+
+// same summation order as the bounded version
+template<typename Real, size_t DIMS>
+Real distSquared(const array<Real, DIMS> &p1, const array<Real, DIMS> &p2) {
+  return distSquaredBounded<DIMS>(p1.data(), p2.data(), std::numeric_limits<Real>::infinity());
+}
+
+}
@@ -7,21 +7,25 @@
 #include <numeric>
 #include <algorithm>
 #include <tuple>
-#include <queue>
 
 #include <iostream>
 
+#include "topk.hpp"
+#include "distance.hpp"
+#include "rotation.hpp"
+
 namespace kdtree {
 
 using std::vector;
 using std::array;
 using std::tuple;
 using std::get;
-using std::priority_queue;
 using std::to_string;
 
 using Real = double;
 using Size = array<Real, 1>::size_type;
+using Neighbor = topk::Neighbor<Real, Size>;
+using Nearest = topk::TopK<Real, Size>;
 
 template<typename T>
 std::string to_string(vector<T> v) {
@@ -100,8 +104,9 @@ struct KdTree {
 };
 
 using ElemIter = vector<int>::iterator;
+using ConstElemIter = vector<int>::const_iterator;
 
-std::string to_string(ElemIter begin, Size size, ElemIter totalEnd) {
+std::string to_string(ConstElemIter begin, Size size, ConstElemIter totalEnd) {
   std::string s{"["};
   for (auto i = begin; i < std::min(begin + size, totalEnd); ++i) {
     s += to_string(*i) + " ";
@@ -109,7 +114,8 @@ std::string to_string(ElemIter begin, Size size, ElemIter totalEnd) {
   return s + "]";
 }
 
-inline Real square(Real v) { return v * v; }
+using distance::square;
+using distance::distSquared;
 
 template<Size DIMS>
 void buildImpl(ElemIter begin, Size size, ElemIter lastElem, vector<Division> &divs, int mydiv,
@@ -121,8 +127,8 @@ void buildImpl(ElemIter begin, Size size, ElemIter lastElem, vector<Division> &d
   int currentDim = 0;
   Real currentVariance = 0;
   for (int d = 0; d < DIMS; d++) {
-    Real average = std::accumulate(begin, end, 0, [&points, d](Real sum, int i){ return sum + points[i][d]; }) / size;
-    Real variance = std::accumulate(begin, end, 0, [&points, d, average](Real sum, int i){ return sum + square(points[i][d] - average); }) / size;
+    Real average = std::accumulate(begin, end, Real{0}, [&points, d](Real sum, int i){ return sum + points[i][d]; }) / size;
+    Real variance = std::accumulate(begin, end, Real{0}, [&points, d, average](Real sum, int i){ return sum + square(points[i][d] - average); }) / size;
     if (variance > currentVariance) {
       currentDim = d;
       currentVariance = variance;
@@ -169,22 +175,43 @@ KdTree buildKdTree(const vector<Point<DIMS>> &points) {
 }
 
 template<Size DIMS>
-Real distSquared(Point<DIMS> p1, Point<DIMS> p2) {
-  Real d = 0;
-  for (auto i = 0; i < DIMS; ++i) {
-    d += square(p1[i] - p2[i]);
+using Transform = rotation::Transform<DIMS>;
+
+// A k-d tree over the first KEEP transformed coordinates of the points, so that the splits
+// need not be along the original axes. The queries are transformed the same way.
+template<Size DIMS, Size KEEP = DIMS>
+struct RotatedKdTree {
+  Transform<DIMS> transform;
+  vector<Point<KEEP>> points; // the transformed points, scanned by the leafs of `tree`
+  KdTree tree;
+};
+
+// The tree is built over the first KEEP (0: all DIMS) transformed coordinates.
+// With KEEP < DIMS (usually with `transform.keep == KEEP`) the tree, its leaf scans and
+// its searches only use KEEP dimensions.
+template<Size KEEP = 0, Size DIMS>
+RotatedKdTree<DIMS, KEEP == 0 ? DIMS : KEEP> buildKdTree(const vector<Point<DIMS>> &points,
+    const Transform<DIMS> &transform) {
+  constexpr Size kept = KEEP == 0 ? DIMS : KEEP;
+  vector<Point<kept>> transformed{};
+  transformed.reserve(points.size());
+  for (const auto &p : points) {
+    transformed.push_back(transform.template project<kept>(p));
   }
-  return d;
+  auto tree = buildKdTree(transformed);
+  return RotatedKdTree<DIMS, kept>{transform, std::move(transformed), std::move(tree)};
 }
 
-int countVisitedLeafes = 0;
+// per thread so that queries can run concurrently
+thread_local int countVisitedLeafes = 0;
+bool printVisitedLeafes = true;
 
-template<Size DIMS, typename Queue>
-void searchNNDown(Size divI, ElemIter begin, Size size,
+template<Size DIMS>
+void searchNNDown(Size divI, ConstElemIter begin, Size size,
     Size largestSizeToMoveUpTo,
     Real minDistInTree, array<Real, DIMS> &minDistInTreePerDim,
-    Queue &nearest,
-    const Point<DIMS> p, Size secoundLastLevel, ElemIter totalEnd, const KdTree &tree, const vector<Point<DIMS>> &points, int k) {
+    Nearest &nearest,
+    const Point<DIMS> p, Size secoundLastLevel, ConstElemIter totalEnd, const KdTree &tree, const vector<Point<DIMS>> &points) {
 
   ++countVisitedLeafes;
 
@@ -198,27 +225,22 @@ void searchNNDown(Size divI, ElemIter begin, Size size,
   }
   for (auto i = begin; i < std::min(begin + size, totalEnd); i++) {
     dbg("[", *i, "]");
-    auto dist = distSquared(points[*i], p);
-    if (nearest.size() < k) {
-      nearest.push({dist, *i});
-    } else if (dist < get<Real>(nearest.top())) {
-      nearest.pop();
-      nearest.push({dist, *i});
-    }
+    // stops summing up once the distance cannot beat the current kth best anymore
+    nearest.push(distance::distSquaredBounded(points[*i], p, nearest.bound()), *i);
   }
   searchNNUp(divI, begin, size,
     largestSizeToMoveUpTo,
     minDistInTree, minDistInTreePerDim,
     nearest,
-    p, secoundLastLevel, totalEnd, tree, points, k);
+    p, secoundLastLevel, totalEnd, tree, points);
 }
 
-template<Size DIMS, typename Queue>
-void searchNNUp(Size divI, ElemIter begin, Size size,
+template<Size DIMS>
+void searchNNUp(Size divI, ConstElemIter begin, Size size,
     Size largestSizeToMoveUpTo,
     Real minDistInTree, array<Real, DIMS> &minDistInTreePerDim,
-    Queue &nearest,
-    const Point<DIMS> p, Size secoundLastLevel, ElemIter totalEnd, const KdTree &tree, const vector<Point<DIMS>> &points, int k) {
+    Nearest &nearest,
+    const Point<DIMS> p, Size secoundLastLevel, ConstElemIter totalEnd, const KdTree &tree, const vector<Point<DIMS>> &points) {
 
   while (size < largestSizeToMoveUpTo) {
     auto isRightChild = divI % 2 == 0;
@@ -232,15 +254,14 @@ void searchNNUp(Size divI, ElemIter begin, Size size,
       minDistInTreePerDimOther[divUp.dim] = distInTreeForDim;
     }
     dbg("", "eval other ", size, " ", minDistInTreeOther, "<"
-      , (nearest.size() < k ? -1 : get<Real>(nearest.top())), " "
+      , nearest.bound(), " "
       , p[divUp.dim], "==", divUp.p, "="
       , "", (p[divUp.dim] == divUp.p ? "t" : "f"), " "
       , distInTreeForDim, "=", p, "[", divUp.dim, "]-", divUp.p
       , minDistInTreePerDimOther, "\n");
-    if (nearest.size() < k
-        || square(p[divUp.dim] - divUp.p) < 0.01
+    if (square(p[divUp.dim] - divUp.p) < 0.01
         || p[divUp.dim] == divUp.p // in case the decisions while going down were half wrong
-        || minDistInTreeOther < get<Real>(nearest.top())) {
+        || minDistInTreeOther < nearest.bound()) { // bound() is infinite as long as less than k were found
       auto beginOther = begin + (isRightChild ? -size : +size);
       auto sizeOther = size;
       auto divOther = divI + (isRightChild ? -1 : +1);
@@ -251,7 +272,7 @@ void searchNNUp(Size divI, ElemIter begin, Size size,
         size,
         minDistInTreeOther, minDistInTreePerDimOther,
         nearest,
-        p, secoundLastLevel, totalEnd, tree, points, k);
+        p, secoundLastLevel, totalEnd, tree, points);
     }
     auto beginUp = begin + (isRightChild ? -size : 0);
     auto sizeUp = size * 2;
@@ -281,15 +302,13 @@ void printTreeDivisions(const KdTree &tree) {
   }
 }
 
+// the k nearest neighbors of p with their squared distances, sorted best first
 template<Size DIMS>
-vector<Size> knn(KdTree tree, const vector<Point<DIMS>> &points, int k, Point<DIMS> p) {
+vector<Neighbor> knnWithDistances(const KdTree &tree, const vector<Point<DIMS>> &points, int k, Point<DIMS> p) {
   dbg("", tree.elems, "\n\n");
   auto secoundLastLevel = tree.divisions.size() / 2; // always floor b/c size is odd
   auto initSize = 1 << log2ceil(tree.elems.size());
-  vector<tuple<Real, Size>> queueContainer{};
-  queueContainer.reserve(k);
-  auto compare = [](const tuple<Real, Size> &e1, const tuple<Real, Size> &e2){ return get<Real>(e1) < get<Real>(e2); };
-  priority_queue<tuple<Real, Size>, decltype(queueContainer), decltype(compare)> nearest{compare, queueContainer};
+  Nearest nearest{static_cast<Size>(k)};
   Size divI = 0; // index of division
   array<Real, DIMS> minDistInTreePerDim{}; // {} to zero initialize
   Real minDistInTree = 0;
@@ -299,13 +318,47 @@ vector<Size> knn(KdTree tree, const vector<Point<DIMS>> &points, int k, Point<DI
     initSize,
     minDistInTree, minDistInTreePerDim,
     nearest,
-    p, secoundLastLevel, tree.elems.end(), tree, points, k);
-  std::cout << "Visited Leafes: " << countVisitedLeafes << "/" << tree.divisions.size() << "\n";
+    p, secoundLastLevel, tree.elems.end(), tree, points);
+  if (printVisitedLeafes) {
+    std::cout << "Visited Leafes: " << countVisitedLeafes << "/" << tree.divisions.size() << "\n";
+  }
+  return nearest.sorted();
+}
+
+// the indices of the k nearest neighbors of p, sorted best first
+template<Size DIMS>
+vector<Size> knn(const KdTree &tree, const vector<Point<DIMS>> &points, int k, Point<DIMS> p) {
+  vector<Size> result{};
+  result.reserve(k);
+  for (const auto &n : knnWithDistances(tree, points, k, p)) {
+    result.push_back(n.index);
+  }
+  return result;
+}
+
+// Searches in the transformed space, the distances are recomputed with the original `points`.
+// If the transform drops coordinates the result is approximate: then `overFetch * k` candidates
+// are searched and the k nearest of them by the original distance are returned.
+template<Size DIMS, Size KEEP>
+vector<Neighbor> knnWithDistances(const RotatedKdTree<DIMS, KEEP> &tree, const vector<Point<DIMS>> &points,
+    int k, Point<DIMS> p, int overFetch = 4) {
+  auto exact = KEEP == DIMS && tree.transform.keep == DIMS;
+  auto candidates = knnWithDistances(tree.tree, tree.points, exact ? k : overFetch * k,
+    tree.transform.template project<KEEP>(p));
+  Nearest nearest{static_cast<Size>(k)};
+  for (const auto &n : candidates) {
+    nearest.push(distance::distSquaredBounded(points[n.index], p, nearest.bound()), n.index);
+  }
+  return nearest.sorted();
+}
+
+template<Size DIMS, Size KEEP>
+vector<Size> knn(const RotatedKdTree<DIMS, KEEP> &tree, const vector<Point<DIMS>> &points,
+    int k, Point<DIMS> p, int overFetch = 4) {
   vector<Size> result{};
   result.reserve(k);
-  while (nearest.size() > 0) {
-    result.push_back(get<Size>(nearest.top()));
-    nearest.pop();
+  for (const auto &n : knnWithDistances(tree, points, k, p, overFetch)) {
+    result.push_back(n.index);
   }
   return result;
 }
@@ -4,9 +4,13 @@
 #include <cmath>
 #include <tuple>
 #include <vector>
+#include <array>
+#include <cstdint>
+#include <algorithm>
 #include <unordered_map>
-#include <unordered_set>
-#include <queue>
+
+#include "topk.hpp"
+#include "distance.hpp"
 
 namespace lsh {
 
@@ -14,29 +18,22 @@ using std::get;
 using std::size_t;
 using std::vector;
 using std::array;
-using std::priority_queue;
 using std::tuple;
 using std::make_tuple;
 template<typename K, typename V>
 using multimap = std::unordered_multimap<K, V>;
 
 using Real = double;
+using Neighbor = topk::Neighbor<Real, size_t>;
+using Nearest = topk::TopK<Real, size_t>;
 
 template<size_t DIMS>
 using Vec = array<Real, DIMS>; // 160 byte
 
 using Maps = vector<multimap<size_t, size_t>>;
 
-inline Real square(Real v) { return v * v; }
-
-template<size_t DIMS>
-Real distSquared(Vec<DIMS> p1, Vec<DIMS> p2) {
-  Real d = 0;
-  for (auto i = 0; i < DIMS; ++i) {
-    d += square(p1[i] - p2[i]);
-  }
-  return d;
-}
+using distance::square;
+using distance::distSquared;
 
 // represents a singular hash function
 template<size_t DIMS>
@@ -100,8 +97,68 @@ struct hash_array {
   }
 };
 
+// compact binary sketch of a point, one bit per random projection
+template<size_t BITS>
+using Sketch = array<std::uint64_t, BITS / 64>;
+
+// Bit i of a sketch is the side of the random hyperplane `dot_product(a[i], v) = b[i]` that `v` lies on.
+// Every hyperplane goes through a random input point, so that the planes cut through the data
+// and the hamming distance of two sketches grows with the euclidean distance of the points.
+template<size_t DIMS, size_t BITS>
+struct Sketches {
+  static_assert(BITS % 64 == 0, "sketch size has to be a multiple of 64 bits");
+  vector<Vec<DIMS>> a; // BITS random directions
+  vector<Real> b;      // BITS offsets
+  vector<Sketch<BITS>> sketches; // one per input point
+};
+
+template<size_t DIMS, size_t BITS>
+Sketch<BITS> eval_sketch(const Sketches<DIMS, BITS> &s, const Vec<DIMS> &v) {
+  Sketch<BITS> sketch{};
+  for (int i = 0; i < BITS; ++i) {
+    Real dot_product = 0;
+    for (int j = 0; j < DIMS; ++j) {
+      dot_product += s.a[i][j] * v[j];
+    }
+    sketch[i / 64] |= static_cast<std::uint64_t>(dot_product >= s.b[i]) << (i % 64);
+  }
+  return sketch;
+}
+
+template<size_t BITS>
+inline size_t hamming(const Sketch<BITS> &s1, const Sketch<BITS> &s2) {
+  size_t d = 0;
+  for (int i = 0; i < BITS / 64; ++i) {
+    d += __builtin_popcountll(s1[i] ^ s2[i]);
+  }
+  return d;
+}
+
+// the hyperplanes of the sketches, the sketches of the points themselves are left empty
+template<size_t DIMS, size_t BITS>
+Sketches<DIMS, BITS> generate_sketch_functions(const vector<Vec<DIMS>> &points) {
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  std::normal_distribution<> a_dist(0, 1);
+  std::uniform_int_distribution<size_t> point_dist(0, points.empty() ? 0 : points.size() - 1);
+
+  Sketches<DIMS, BITS> s{vector<Vec<DIMS>>(BITS), vector<Real>(BITS, 0), {}};
+  for (int i = 0; i < BITS; ++i) {
+    for (int j = 0; j < DIMS; ++j) {
+      s.a[i][j] = a_dist(gen);
+    }
+    if (!points.empty()) {
+      const auto &p = points[point_dist(gen)];
+      for (int j = 0; j < DIMS; ++j) {
+        s.b[i] += s.a[i][j] * p[j];
+      }
+    }
+  }
+  return s;
+}
+
 template<size_t DIMS, size_t K>
-auto generate_hashes(vector<Vec<DIMS>> points, Real r, size_t L) {
+auto generate_hashes(const vector<Vec<DIMS>> &points, Real r, size_t L) {
   auto gs = generate_hash_functions<DIMS, K>(r, L);
   Maps maps(L);
   for (int i = 0; i < L; ++i) {
@@ -115,40 +172,140 @@ auto generate_hashes(vector<Vec<DIMS>> points, Real r, size_t L) {
   return make_tuple(maps, gs);
 }
 
+// like `generate_hashes` but additionally stores a `BITS` bit sketch of every point
+template<size_t DIMS, size_t K, size_t BITS>
+auto generate_hashes_with_sketches(const vector<Vec<DIMS>> &points, Real r, size_t L) {
+  auto gs = generate_hash_functions<DIMS, K>(r, L);
+  auto sketches = generate_sketch_functions<DIMS, BITS>(points);
+  Maps maps(L);
+  sketches.sketches.reserve(points.size());
+  for (int j = 0; j < points.size(); ++j) { // one pass: all hashes and the sketch of a point
+    const auto &p = points[j];
+    for (int i = 0; i < L; ++i) {
+      maps[i].insert(std::make_pair(eval_g(gs[i], p, r), static_cast<size_t>(j)));
+    }
+    sketches.sketches.push_back(eval_sketch(sketches, p));
+  }
+  return make_tuple(std::move(maps), std::move(gs), std::move(sketches));
+}
+
+// number of exact distances computed by the last knn query of this thread
+thread_local size_t countExactDistances = 0;
+
+// Removes repeated ids, keeping the first occurrences in order. Uses an open addressing
+// hash set sized for `ids`, so the cost depends only on ids.size().
+inline void remove_duplicates(vector<size_t> &ids) {
+  size_t capacity = 16;
+  while (capacity < 2 * ids.size()) {
+    capacity *= 2;
+  }
+  vector<size_t> seen(capacity, 0); // id + 1, 0 for empty slots
+  auto out = ids.begin();
+  for (auto id : ids) {
+    auto slot = (id * 0x9E3779B97F4A7C15ull) & (capacity - 1);
+    while (seen[slot] != 0 && seen[slot] != id + 1) {
+      slot = (slot + 1) & (capacity - 1);
+    }
+    if (seen[slot] == 0) {
+      seen[slot] = id + 1;
+      *out++ = id;
+    }
+  }
+  ids.erase(out, ids.end());
+}
+
+// every point that hashes to the same bucket as p in at least one of the maps, each once,
+// in the order of the maps
 template<size_t DIMS, size_t K>
-vector<size_t> knn(tuple<Maps, vector<g_t<DIMS, K>>> maps_and_gs,
-    vector<Vec<DIMS>> points, Vec<DIMS> p, Real r, size_t k) {
-  auto maps = get<0>(maps_and_gs);
-  auto gs = get<1>(maps_and_gs);
-  using E = tuple<Real, size_t>;
-  vector<E> queueContainer{};
-  queueContainer.reserve(k);
-  auto compare = [](const E &e1, const E &e2)
-    { return get<Real>(e1) < get<Real>(e2); };
-  priority_queue<tuple<Real, size_t>, decltype(queueContainer),
-    decltype(compare)> nearest{compare, queueContainer};
-  std::unordered_set<size_t> tested_points;
+vector<size_t> candidates(const Maps &maps, const vector<g_t<DIMS, K>> &gs, const Vec<DIMS> &p, Real r) {
+  vector<size_t> result{};
   for (int i = 0; i < maps.size(); ++i) {
-    const auto &g = gs[i];
-    const auto &m = maps[i];
-    const auto range = m.equal_range(eval_g(g, p, r));
+    const auto range = maps[i].equal_range(eval_g(gs[i], p, r));
     for (auto e = range.first; e != range.second; ++e) {
-      if (tested_points.end() != tested_points.find(e->second)) { continue; }
-      tested_points.insert(e->second);
-      auto d = distSquared(points[e->second], p);
-      if (nearest.size() < k) {
-        nearest.push({d, e->second});
-      } else if (d < get<Real>(nearest.top())) {
-        nearest.pop();
-        nearest.push({d, e->second});
-      }
+      result.push_back(e->second);
     }
   }
+  remove_duplicates(result);
+  return result;
+}
+
+// the k candidates nearest to p, sorted best first
+template<size_t DIMS>
+vector<Neighbor> verify(const vector<Vec<DIMS>> &points, const Vec<DIMS> &p,
+    const vector<size_t> &candidates, size_t k) {
+  Nearest nearest{k};
+  for (auto j : candidates) {
+    nearest.push(distance::distSquaredBounded(points[j], p, nearest.bound()), j);
+  }
+  countExactDistances = candidates.size();
+  return nearest.sorted();
+}
+
+// Like `verify`, but the candidates are first ranked by the hamming distance of their sketches
+// to `sketch` and only the best `prefilter` fraction of them (at least k) gets the exact distance.
+// `prefilter` is clamped to [0, 1], NaN means no prefiltering.
+template<size_t DIMS, size_t BITS>
+vector<Neighbor> verify(const vector<Vec<DIMS>> &points, const Vec<DIMS> &p,
+    const vector<size_t> &candidates, size_t k,
+    const Sketches<DIMS, BITS> &sketches, const Sketch<BITS> &sketch, Real prefilter) {
+  prefilter = std::isnan(prefilter) ? 1 : std::min(std::max(prefilter, Real{0}), Real{1});
+  auto keep = std::min(candidates.size(),
+    std::max(k, static_cast<size_t>(std::ceil(prefilter * candidates.size()))));
+  if (keep == candidates.size()) {
+    return verify(points, p, candidates, k);
+  }
+  vector<tuple<size_t, size_t>> ranked{}; // (hamming distance, point)
+  ranked.reserve(candidates.size());
+  for (auto j : candidates) {
+    ranked.emplace_back(hamming<BITS>(sketch, sketches.sketches[j]), j);
+  }
+  std::nth_element(ranked.begin(), ranked.begin() + keep, ranked.end());
+  Nearest nearest{k};
+  for (int i = 0; i < keep; ++i) {
+    auto j = get<1>(ranked[i]);
+    nearest.push(distance::distSquaredBounded(points[j], p, nearest.bound()), j);
+  }
+  countExactDistances = keep;
+  return nearest.sorted();
+}
+
+// the approximate k nearest neighbors of p with their squared distances, sorted best first
+template<size_t DIMS, size_t K>
+vector<Neighbor> knn_with_distances(const tuple<Maps, vector<g_t<DIMS, K>>> &maps_and_gs,
+    const vector<Vec<DIMS>> &points, Vec<DIMS> p, Real r, size_t k) {
+  return verify(points, p, candidates(get<0>(maps_and_gs), get<1>(maps_and_gs), p, r), k);
+}
+
+// the indices of the approximate k nearest neighbors of p, sorted best first
+template<size_t DIMS, size_t K>
+vector<size_t> knn(const tuple<Maps, vector<g_t<DIMS, K>>> &maps_and_gs,
+    const vector<Vec<DIMS>> &points, Vec<DIMS> p, Real r, size_t k) {
+  vector<size_t> result{};
+  result.reserve(k);
+  for (const auto &n : knn_with_distances<DIMS, K>(maps_and_gs, points, p, r, k)) {
+    result.push_back(n.index);
+  }
+  return result;
+}
+
+// With sketches: only the best `prefilter` fraction of the candidates by sketch hamming distance
+// is checked with the exact distance, see `verify`.
+template<size_t DIMS, size_t K, size_t BITS>
+vector<Neighbor> knn_with_distances(
+    const tuple<Maps, vector<g_t<DIMS, K>>, Sketches<DIMS, BITS>> &index,
+    const vector<Vec<DIMS>> &points, Vec<DIMS> p, Real r, size_t k, Real prefilter) {
+  const auto &sketches = get<2>(index);
+  return verify(points, p, candidates(get<0>(index), get<1>(index), p, r), k,
+    sketches, eval_sketch(sketches, p), prefilter);
+}
+
+template<size_t DIMS, size_t K, size_t BITS>
+vector<size_t> knn(const tuple<Maps, vector<g_t<DIMS, K>>, Sketches<DIMS, BITS>> &index,
+    const vector<Vec<DIMS>> &points, Vec<DIMS> p, Real r, size_t k, Real prefilter) {
   vector<size_t> result{};
   result.reserve(k);
-  while (nearest.size() > 0) {
-    result.push_back(get<size_t>(nearest.top()));
-    nearest.pop();
+  for (const auto &n : knn_with_distances<DIMS, K, BITS>(index, points, p, r, k, prefilter)) {
+    result.push_back(n.index);
   }
   return result;
 }
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cmath>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <cstddef>
+
+#include "distance.hpp"
+
+namespace rotation {
+
+using std::vector;
+using std::array;
+using std::size_t;
+
+using Real = double;
+
+template<size_t DIMS>
+using Vec = array<Real, DIMS>;
+
+// dot product with independent partial sums like `distance::distSquaredBounded`, so that it vectorizes
+template<size_t DIMS>
+Real dot(const Vec<DIMS> &a, const Vec<DIMS> &b) {
+  using distance::lanes;
+  Real acc[lanes] = {};
+  size_t j = 0;
+  for (; j + lanes <= DIMS; j += lanes) {
+#pragma omp simd
+    for (size_t l = 0; l < lanes; ++l) {
+      acc[l] += a[j + l] * b[j + l];
+    }
+  }
+  auto d = distance::laneSum(acc);
+  for (; j < DIMS; ++j) {
+    d += a[j] * b[j];
+  }
+  return d;
+}
+
+// y = rows * (x - center), coordinates from `keep` on are dropped (set to 0)
+template<size_t DIMS>
+struct Transform {
+  Vec<DIMS> center;
+  array<Vec<DIMS>, DIMS> rows; // orthonormal
+  size_t keep;
+
+  // the first KEEP coordinates of `apply(x)`, only those are computed
+  template<size_t KEEP>
+  Vec<KEEP> project(const Vec<DIMS> &x) const {
+    Vec<DIMS> centered;
+    for (size_t j = 0; j < DIMS; ++j) {
+      centered[j] = x[j] - center[j];
+    }
+    Vec<KEEP> y{};
+    for (size_t i = 0; i < std::min(KEEP, keep); ++i) {
+      y[i] = dot(rows[i], centered);
+    }
+    return y;
+  }
+
+  Vec<DIMS> apply(const Vec<DIMS> &x) const {
+    return project<DIMS>(x);
+  }
+};
+
+// makes the rows orthonormal (modified Gram-Schmidt)
+template<size_t DIMS>
+void orthonormalize(array<Vec<DIMS>, DIMS> &rows) {
+  for (size_t i = 0; i < DIMS; ++i) {
+    for (size_t j = 0; j < i; ++j) {
+      Real dot_product = 0;
+      for (size_t d = 0; d < DIMS; ++d) {
+        dot_product += rows[i][d] * rows[j][d];
+      }
+      for (size_t d = 0; d < DIMS; ++d) {
+        rows[i][d] -= dot_product * rows[j][d];
+      }
+    }
+    Real norm = 0;
+    for (size_t d = 0; d < DIMS; ++d) {
+      norm += rows[i][d] * rows[i][d];
+    }
+    norm = std::sqrt(norm);
+    for (size_t d = 0; d < DIMS; ++d) {
+      rows[i][d] /= norm;
+    }
+  }
+}
+
+// uniformly distributed rotation around the origin
+template<size_t DIMS>
+Transform<DIMS> randomRotation(std::mt19937 &gen) {
+  std::normal_distribution<> a_dist(0, 1);
+  Transform<DIMS> t{};
+  for (auto &row : t.rows) {
+    for (auto &e : row) {
+      e = a_dist(gen);
+    }
+  }
+  orthonormalize(t.rows);
+  t.keep = DIMS;
+  return t;
+}
+
+// eigenvectors (as rows) and eigenvalues of a symmetric matrix with the cyclic Jacobi method
+template<size_t DIMS>
+void symmetricEigen(array<Vec<DIMS>, DIMS> a, array<Vec<DIMS>, DIMS> &vectors, Vec<DIMS> &values) {
+  for (size_t i = 0; i < DIMS; ++i) {
+    vectors[i] = Vec<DIMS>{};
+    vectors[i][i] = 1;
+  }
+  for (int sweep = 0; sweep < 100; ++sweep) {
+    Real off = 0;
+    Real total = 0;
+    for (size_t p = 0; p < DIMS; ++p) {
+      for (size_t q = 0; q < DIMS; ++q) {
+        total += a[p][q] * a[p][q];
+        if (p != q) {
+          off += a[p][q] * a[p][q];
+        }
+      }
+    }
+    if (off <= 1e-24 * total) {
+      break;
+    }
+    for (size_t p = 0; p < DIMS; ++p) {
+      for (size_t q = p + 1; q < DIMS; ++q) {
+        if (a[p][q] == 0) {
+          continue;
+        }
+        auto theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+        auto t = (theta >= 0 ? 1 : -1) / (std::abs(theta) + std::sqrt(theta * theta + 1));
+        auto c = 1 / std::sqrt(t * t + 1);
+        auto s = t * c;
+        for (size_t k = 0; k < DIMS; ++k) { // a = a * J
+          auto akp = a[k][p];
+          auto akq = a[k][q];
+          a[k][p] = c * akp - s * akq;
+          a[k][q] = s * akp + c * akq;
+        }
+        for (size_t k = 0; k < DIMS; ++k) { // a = J^T * a, vectors = J^T * vectors
+          auto apk = a[p][k];
+          auto aqk = a[q][k];
+          a[p][k] = c * apk - s * aqk;
+          a[q][k] = s * apk + c * aqk;
+          auto vpk = vectors[p][k];
+          auto vqk = vectors[q][k];
+          vectors[p][k] = c * vpk - s * vqk;
+          vectors[q][k] = s * vpk + c * vqk;
+        }
+      }
+    }
+  }
+  for (size_t i = 0; i < DIMS; ++i) {
+    values[i] = a[i][i];
+  }
+}
+
+// Rotation onto the principal axes of (a sample of at most `sampleSize`) points,
+// sorted by decreasing variance. Only the first `keep` axes are kept.
+template<size_t DIMS>
+Transform<DIMS> pcaRotation(const vector<Vec<DIMS>> &points, size_t sampleSize, size_t keep, std::mt19937 &gen) {
+  vector<size_t> sample(points.size());
+  std::iota(sample.begin(), sample.end(), 0);
+  if (sampleSize < sample.size()) {
+    std::shuffle(sample.begin(), sample.end(), gen);
+    sample.resize(sampleSize);
+  }
+  Transform<DIMS> t{};
+  for (auto i : sample) {
+    for (size_t d = 0; d < DIMS; ++d) {
+      t.center[d] += points[i][d] / sample.size();
+    }
+  }
+  array<Vec<DIMS>, DIMS> covariance{};
+  for (auto i : sample) {
+    for (size_t p = 0; p < DIMS; ++p) {
+      auto dp = points[i][p] - t.center[p];
+      for (size_t q = 0; q < DIMS; ++q) {
+        covariance[p][q] += dp * (points[i][q] - t.center[q]) / sample.size();
+      }
+    }
+  }
+  array<Vec<DIMS>, DIMS> vectors;
+  Vec<DIMS> values;
+  symmetricEigen(covariance, vectors, values);
+  array<size_t, DIMS> order;
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&values](size_t a, size_t b){ return values[a] > values[b]; });
+  for (size_t i = 0; i < DIMS; ++i) {
+    t.rows[i] = vectors[order[i]];
+  }
+  t.keep = std::min(std::max<size_t>(keep, 1), DIMS);
+  return t;
+}
+
+// Randomly rotates the kept coordinates of `t`, which spreads their variance evenly
+// while the dropped (low variance) coordinates stay dropped.
+template<size_t DIMS>
+Transform<DIMS> rotateKept(Transform<DIMS> t, std::mt19937 &gen) {
+  std::normal_distribution<> a_dist(0, 1);
+  array<Vec<DIMS>, DIMS> q{};
+  for (size_t i = 0; i < t.keep; ++i) {
+    for (size_t j = 0; j < t.keep; ++j) {
+      q[i][j] = a_dist(gen);
+    }
+  }
+  for (size_t i = t.keep; i < DIMS; ++i) { // identity on the dropped coordinates
+    q[i][i] = 1;
+  }
+  orthonormalize(q);
+  array<Vec<DIMS>, DIMS> rows{};
+  for (size_t i = 0; i < DIMS; ++i) {
+    for (size_t j = 0; j < DIMS; ++j) {
+      for (size_t d = 0; d < DIMS; ++d) {
+        rows[i][d] += q[i][j] * t.rows[j][d];
+      }
+    }
+  }
+  t.rows = rows;
+  return t;
+}
+
+}
@@ -0,0 +1,451 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <array>
+#include <cmath>
+
+namespace scheduler {
+
+using std::vector;
+using std::size_t;
+
+using Clock = std::chrono::steady_clock;
+using Task = std::function<void()>;
+
+inline double micros(Clock::duration d) {
+  return std::chrono::duration<double, std::micro>(d).count();
+}
+
+// Fixed number of worker threads, each with its own task queue.
+// A worker runs the oldest task of its own queue and steals the newest task
+// of another queue when its own queue is empty.
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t threads) : queues(std::max<size_t>(threads, 1)) {
+    for (auto &q : queues) {
+      q = std::make_unique<Queue>();
+    }
+    for (size_t i = 0; i < queues.size(); ++i) {
+      workers.emplace_back([this, i]{ run(i); });
+    }
+  }
+
+  // runs all submitted tasks before returning
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      stopping = true;
+    }
+    wakeup.notify_all();
+    for (auto &w : workers) {
+      w.join();
+    }
+  }
+
+  size_t size() const { return workers.size(); }
+
+  void submit(Task task) {
+    auto &q = *queues[nextQueue++ % queues.size()];
+    {
+      std::lock_guard<std::mutex> lock(q.mutex);
+      q.tasks.push_back(std::move(task));
+    }
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      ++pending;
+    }
+    wakeup.notify_one();
+  }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  bool popOwn(size_t i, Task &task) {
+    auto &q = *queues[i];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty()) {
+      return false;
+    }
+    task = std::move(q.tasks.front());
+    q.tasks.pop_front();
+    return true;
+  }
+
+  bool steal(size_t i, Task &task) {
+    for (size_t j = 1; j < queues.size(); ++j) {
+      auto &q = *queues[(i + j) % queues.size()];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (!q.tasks.empty()) {
+        task = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void run(size_t i) {
+    for (;;) {
+      Task task;
+      if (popOwn(i, task) || steal(i, task)) {
+        {
+          std::lock_guard<std::mutex> lock(sleepMutex);
+          --pending;
+        }
+        task();
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      wakeup.wait(lock, [this]{ return stopping || pending > 0; });
+      if (stopping && pending == 0) {
+        return;
+      }
+    }
+  }
+
+  vector<std::unique_ptr<Queue>> queues;
+  vector<std::thread> workers;
+  std::atomic<size_t> nextQueue{0};
+  std::mutex sleepMutex;
+  std::condition_variable wakeup;
+  size_t pending = 0; // submitted but not yet taken, guarded by sleepMutex
+  bool stopping = false;
+};
+
+// latency distribution in microseconds
+struct Percentiles {
+  size_t count;
+  double p50;
+  double p90;
+  double p99;
+  double max;
+};
+
+inline Percentiles percentiles(vector<double> samples) {
+  if (samples.empty()) {
+    return Percentiles{0, 0, 0, 0, 0};
+  }
+  auto at = [&samples](double q) {
+    auto n = std::min(static_cast<size_t>(q * samples.size()), samples.size() - 1);
+    std::nth_element(samples.begin(), samples.begin() + n, samples.end());
+    return samples[n];
+  };
+  return Percentiles{samples.size(), at(0.5), at(0.9), at(0.99),
+    *std::max_element(samples.begin(), samples.end())};
+}
+
+// Latency distribution with fixed memory: counts in logarithmic buckets, `subBuckets` per
+// power of two starting at `minValue` microseconds, so that a percentile is off by less
+// than a factor 2^(1/subBuckets) (about 4.4%). Values below `minValue` share the first bucket,
+// values above the range the last one; `max` is exact.
+class Histogram {
+public:
+  static constexpr size_t subBuckets = 16;
+  static constexpr size_t buckets = 32 * subBuckets; // up to about 430 s
+  static constexpr double minValue = 0.1;
+
+  void add(double value, size_t n = 1) {
+    counts[bucket(value)] += n;
+    count += n;
+    max = std::max(max, value);
+  }
+
+  void clear() {
+    counts.fill(0);
+    count = 0;
+    max = 0;
+  }
+
+  Percentiles percentiles() const {
+    if (count == 0) {
+      return Percentiles{0, 0, 0, 0, 0};
+    }
+    return Percentiles{count, at(0.5), at(0.9), at(0.99), max};
+  }
+
+private:
+  static size_t bucket(double value) {
+    if (!(value > minValue)) { // also NaN
+      return 0;
+    }
+    auto b = std::log2(value / minValue) * subBuckets;
+    return b >= buckets - 1 ? buckets - 1 : static_cast<size_t>(b);
+  }
+
+  // the upper end of the bucket with the q quantile, but at most `max`
+  double at(double q) const {
+    auto rank = std::min(static_cast<size_t>(q * count), count - 1);
+    size_t seen = 0;
+    for (size_t b = 0; b < buckets; ++b) {
+      seen += counts[b];
+      if (seen > rank) {
+        return std::min(minValue * std::exp2(static_cast<double>(b + 1) / subBuckets), max);
+      }
+    }
+    return max;
+  }
+
+  std::array<size_t, buckets> counts{};
+  size_t count = 0;
+  double max = 0;
+};
+
+struct Report {
+  Percentiles queue;   // from submit until the batch of the query started
+  Percentiles service; // run time of the batch of the query
+  size_t batches;
+  double meanBatchSize;
+  size_t failed;         // queries whose batch threw or returned the wrong number of results
+  size_t callbackErrors; // exceptions thrown by callbacks or error callbacks
+};
+
+struct Options {
+  size_t maxBatchSize = 32;
+  // a query waits at most this long for other queries to share its batch
+  std::chrono::microseconds maxWait{500};
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+};
+
+// Collects single queries from any number of threads into micro-batches and
+// runs `batchFunction` on them in a thread pool.
+// A batch is started when `maxBatchSize` queries are waiting or the oldest
+// waiting query has waited `maxWait`.
+// `batchFunction` has to return one result per query in the same order,
+// otherwise all queries of the batch fail with a `std::length_error`.
+template<typename Query, typename Result>
+class Executor {
+public:
+  using BatchFunction = std::function<vector<Result>(const vector<Query> &)>;
+  using Callback = std::function<void(Result)>;
+  using ErrorCallback = std::function<void(std::exception_ptr)>;
+
+  explicit Executor(BatchFunction batchFunction, Options options = Options{})
+    : batchFunction(std::move(batchFunction)),
+      options(options),
+      pool(options.threads),
+      dispatcher([this]{ dispatch(); }) {}
+
+  // answers all submitted queries before returning
+  ~Executor() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    arrived.notify_one();
+    dispatcher.join();
+  }
+
+  std::future<Result> submit(Query query) {
+    auto promise = std::make_shared<std::promise<Result>>();
+    auto future = promise->get_future();
+    submit(std::move(query),
+      [promise](Result r){ promise->set_value(std::move(r)); },
+      [promise](std::exception_ptr e){ promise->set_exception(e); });
+    return future;
+  }
+
+  // `callback` (or `onError` if the batch failed) is called on a pool thread,
+  // exceptions thrown by them are only counted in `Report::callbackErrors`
+  void submit(Query query, Callback callback, ErrorCallback onError) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending.push_back(Pending{std::move(query), std::move(callback), std::move(onError), Clock::now()});
+    }
+    arrived.notify_one();
+  }
+
+  Report report() {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return Report{queueTimes.percentiles(), serviceTimes.percentiles(), batches,
+      batches == 0 ? 0 : static_cast<double>(queryCount) / batches,
+      failed, callbackErrors};
+  }
+
+  void resetStats() {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    queueTimes.clear();
+    serviceTimes.clear();
+    batches = 0;
+    queryCount = 0;
+    failed = 0;
+    callbackErrors = 0;
+  }
+
+private:
+  struct Pending {
+    Query query;
+    Callback callback;
+    ErrorCallback onError;
+    Clock::time_point submitted;
+  };
+
+  void dispatch() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      arrived.wait(lock, [this]{ return stopping || !pending.empty(); });
+      if (pending.empty()) {
+        return;
+      }
+      arrived.wait_until(lock, pending.front().submitted + options.maxWait,
+        [this]{ return stopping || pending.size() >= options.maxBatchSize; });
+      auto n = std::min(pending.size(), std::max<size_t>(options.maxBatchSize, 1));
+      auto batch = std::make_shared<vector<Pending>>(
+        std::make_move_iterator(pending.begin()), std::make_move_iterator(pending.begin() + n));
+      pending.erase(pending.begin(), pending.begin() + n);
+      lock.unlock();
+      pool.submit([this, batch]{ run(*batch); });
+      lock.lock();
+    }
+  }
+
+  void run(vector<Pending> &batch) {
+    vector<Query> queries{};
+    queries.reserve(batch.size());
+    for (auto &e : batch) {
+      queries.push_back(std::move(e.query));
+    }
+    auto start = Clock::now();
+    vector<Result> results;
+    std::exception_ptr error;
+    try {
+      results = batchFunction(queries);
+      if (results.size() != batch.size()) {
+        throw std::length_error("batch function returned " + std::to_string(results.size())
+          + " results for " + std::to_string(batch.size()) + " queries");
+      }
+    } catch (...) {
+      error = std::current_exception();
+    }
+    auto end = Clock::now();
+    // before the answers, so that whoever waits for an answer also sees its stats
+    {
+      std::lock_guard<std::mutex> lock(statsMutex);
+      for (const auto &e : batch) {
+        queueTimes.add(micros(start - e.submitted));
+      }
+      serviceTimes.add(micros(end - start), batch.size());
+      ++batches;
+      queryCount += batch.size();
+      if (error) {
+        failed += batch.size();
+      }
+    }
+    size_t errors = 0;
+    for (size_t i = 0; i < batch.size(); ++i) {
+      try { // an exception escaping a pool thread would terminate
+        if (error) {
+          batch[i].onError(error);
+        } else {
+          batch[i].callback(std::move(results[i]));
+        }
+      } catch (...) {
+        ++errors;
+      }
+    }
+    if (errors > 0) {
+      std::lock_guard<std::mutex> lock(statsMutex);
+      callbackErrors += errors;
+    }
+  }
+
+  BatchFunction batchFunction;
+  Options options;
+
+  std::mutex mutex;
+  std::condition_variable arrived;
+  std::deque<Pending> pending;
+  bool stopping = false;
+
+  std::mutex statsMutex;
+  // per query, bounded memory for long running services
+  Histogram queueTimes;
+  Histogram serviceTimes;
+  size_t batches = 0;
+  size_t queryCount = 0;
+  size_t failed = 0;
+  size_t callbackErrors = 0;
+
+  // declared last: destroyed first, so that the tasks still see the members above
+  ThreadPool pool;
+  std::thread dispatcher;
+};
+
+struct LoadResult {
+  size_t queries;
+  size_t failed; // queries answered with an error
+  double seconds;
+  double throughput; // successfully answered queries per second
+  Percentiles latency; // from submit until the answer arrived, without failed queries
+};
+
+// Local load generator: `clients` threads together submit `rate` queries per second
+// for `duration` without waiting for answers (open loop), then all answers are awaited.
+template<typename Query, typename Result>
+LoadResult runLoad(Executor<Query, Result> &executor, const vector<Query> &queries,
+    size_t clients, double rate, std::chrono::milliseconds duration) {
+  std::mutex latencyMutex;
+  std::condition_variable allAnswered;
+  vector<double> latencies;
+  size_t submitted = 0;
+  size_t answered = 0;
+  size_t failed = 0;
+  Clock::time_point lastAnswer;
+  auto answer = [&](Clock::time_point submittedAt, bool ok) {
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    lastAnswer = Clock::now();
+    if (ok) {
+      latencies.push_back(micros(lastAnswer - submittedAt));
+    } else {
+      ++failed;
+    }
+    ++answered;
+    allAnswered.notify_all();
+  };
+
+  auto start = Clock::now();
+  auto interval = std::chrono::duration_cast<Clock::duration>(
+    std::chrono::duration<double>(clients / rate));
+  vector<std::thread> threads;
+  for (size_t c = 0; c < clients; ++c) {
+    threads.emplace_back([&, c]{
+      auto next = start + interval * c / clients;
+      for (size_t i = c; next < start + duration; i += clients, next += interval) {
+        std::this_thread::sleep_until(next);
+        {
+          std::lock_guard<std::mutex> lock(latencyMutex);
+          ++submitted;
+        }
+        auto submittedAt = Clock::now();
+        executor.submit(queries[i % queries.size()],
+          [&answer, submittedAt](Result){ answer(submittedAt, true); },
+          [&answer, submittedAt](std::exception_ptr){ answer(submittedAt, false); });
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  std::unique_lock<std::mutex> lock(latencyMutex);
+  allAnswered.wait(lock, [&]{ return answered == submitted; });
+  auto seconds = std::chrono::duration<double>(lastAnswer - start).count();
+  return LoadResult{submitted, failed, seconds, seconds > 0 ? latencies.size() / seconds : 0,
+    percentiles(latencies)};
+}
+
+}
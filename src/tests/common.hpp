@@ -6,7 +6,11 @@
 #include <numeric>
 #include <algorithm>
 #include <tuple>
-#include <queue>
+#include <random>
+
+#include "topk.hpp"
+#include "distance.hpp"
+#include "rotation.hpp"
 
 template<typename Stream, typename T>
 Stream& operator << (Stream& s, std::vector<T>& v) {
@@ -23,16 +27,8 @@ using Real = double;
 using Size = std::array<double, 1>::size_type;
 using std::get;
 
-inline double  square(double v) { return v * v; }
-
-template<Size dims>
-double distSquared(std::array<double, dims> p1, std::array<double, dims> p2) {
-  double d = 0;
-  for (auto i = 0; i < dims; ++i) {
-    d += square(p1[i] - p2[i]);
-  }
-  return d;
-}
+using distance::square;
+using distance::distSquared;
 
 // in a full grid get the direct neighbours (up to 2*D many)
 inline std::vector<int> get_neighbours(int D, int n, int p) {
@@ -55,29 +51,73 @@ inline std::vector<int> get_neighbours(int D, int n, int p) {
 
 template<Size DIMS>
 std::vector<Size> simple_knn(std::vector<std::array<double, DIMS>> points, int k, std::array<double, DIMS> p) {
-  using E = std::tuple<double, Size>;
-  std::vector<E> queueContainer{};
-  queueContainer.reserve(k);
-  auto compare = [](const E &e1, const E &e2){ return get<double>(e1) < get<double>(e2); };
-  std::priority_queue<E, std::vector<E>, decltype(compare)> nearest{compare, queueContainer};
-  for (int i = 0; i < k && i < points.size(); ++i) {
-    auto d = distSquared(points[i], p);
-    nearest.push({d, i});
+  topk::TopK<double, Size> nearest{static_cast<Size>(k)};
+  for (Size i = 0; i < points.size(); ++i) {
+    nearest.push(distSquared(points[i], p), i);
   }
-  for (int i = k; i < points.size(); ++i) {
-    auto d = distSquared(points[i], p);
-    if (d < get<double>(nearest.top())) {
-      nearest.pop();
-      nearest.push({d, i});
+  return nearest.indices();
+}
+
+// points with independent gaussian coordinates, coordinate d with standard deviation scales[d]
+template<Size dims>
+std::vector<std::array<double, dims>> gen_gaussian_points(int n, const std::array<double, dims> &scales,
+    std::mt19937 &gen) {
+  std::normal_distribution<> dist(0, 1);
+  std::vector<std::array<double, dims>> points(n);
+  for (auto &p : points) {
+    for (int d = 0; d < dims; ++d) {
+      p[d] = dist(gen) * scales[d];
     }
   }
-  std::vector<Size> result{};
-  result.reserve(k);
-  while (nearest.size() > 0) {
-    result.push_back(get<Size>(nearest.top()));
-    nearest.pop();
+  return points;
+}
+
+template<Size dims>
+std::vector<std::array<double, dims>> gen_gaussian_points(int n, std::mt19937 &gen) {
+  std::array<double, dims> scales;
+  scales.fill(1);
+  return gen_gaussian_points<dims>(n, scales, gen);
+}
+
+// gaussian points like `gen_gaussian_points`, randomly rotated around the origin and moved to `center`,
+// so that their variance is mostly off-axis
+template<Size dims>
+std::vector<std::array<double, dims>> gen_correlated_points(int n, const std::array<double, dims> &scales,
+    double center, std::mt19937 &gen) {
+  auto mixing = rotation::randomRotation<dims>(gen);
+  auto points = gen_gaussian_points<dims>(n, scales, gen);
+  for (auto &p : points) {
+    auto x = p;
+    for (int d = 0; d < dims; ++d) {
+      p[d] = center;
+      for (int j = 0; j < dims; ++j) {
+        p[d] += mixing.rows[j][d] * x[j];
+      }
+    }
   }
-  return result;
+  return points;
+}
+
+// points close to a random `rank` dimensional subspace (like embeddings with a low intrinsic dimension):
+// gaussian latent coordinates mapped by a random gaussian matrix plus gaussian noise
+template<Size dims>
+std::vector<std::array<double, dims>> gen_low_rank_points(int n, int rank, double noise, std::mt19937 &gen) {
+  std::normal_distribution<> dist(0, 1);
+  auto mixing = gen_gaussian_points<dims>(rank, gen);
+  std::vector<std::array<double, dims>> points(n);
+  std::vector<double> latent(rank);
+  for (auto &p : points) {
+    for (auto &e : latent) {
+      e = dist(gen);
+    }
+    for (int d = 0; d < dims; ++d) {
+      p[d] = noise * dist(gen);
+      for (int l = 0; l < rank; ++l) {
+        p[d] += mixing[l][d] * latent[l];
+      }
+    }
+  }
+  return points;
 }
 
 template<Size dims>
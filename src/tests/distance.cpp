@@ -0,0 +1,47 @@
+#include <iostream>
+#include <array>
+#include <vector>
+#include <random>
+#include <numeric>
+#include <algorithm>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "distance.hpp"
+#include "tests/common.hpp"
+
+BOOST_AUTO_TEST_SUITE(distance_tests)
+
+template<Size dims>
+void check_bounded(std::mt19937 &gen) {
+  for (int i = 0; i < 100; ++i) {
+    auto ps = gen_gaussian_points<dims>(2, gen);
+    const auto &p1 = ps[0];
+    const auto &p2 = ps[1];
+    auto exact = distSquared(p1, p2);
+    double naive = 0;
+    for (int d = 0; d < dims; ++d) {
+      naive += (p1[d] - p2[d]) * (p1[d] - p2[d]);
+    }
+    BOOST_CHECK_CLOSE(exact, naive, 1e-9);
+    // the bound is not reached: exact result
+    BOOST_CHECK_CLOSE(distance::distSquaredBounded(p1, p2, exact * 1.01), exact, 1e-12);
+    // the bound is reached: anything at least as large as the bound
+    auto bound = exact * 0.5;
+    BOOST_CHECK(distance::distSquaredBounded(p1, p2, bound) >= bound);
+    BOOST_CHECK(distance::distSquaredBounded(p1, p2, bound) <= exact * (1 + 1e-9));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(bounded) {
+  std::mt19937 gen(7);
+  check_bounded<1>(gen);
+  check_bounded<15>(gen);
+  check_bounded<16>(gen);
+  check_bounded<21>(gen);
+  check_bounded<64>(gen);
+  check_bounded<128>(gen);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
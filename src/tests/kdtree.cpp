@@ -1,5 +1,8 @@
 #include <iostream>
 #include <string>
+#include <random>
+#include <algorithm>
+#include <iterator>
 
 #define BOOST_TEST_DYN_LINK
 #include <boost/test/unit_test.hpp>
@@ -103,6 +106,118 @@ BOOST_AUTO_TEST_CASE(full_grid) {
   run_knn<10>(5);
 }
 
+// random points in many dimensions, so that the leaf scans abandon distances early
+template<Size dims>
+void run_knn_random(int n, int k) {
+  std::mt19937 gen(dims);
+  std::array<double, dims> scales;
+  for (int d = 0; d < dims; ++d) {
+    scales[d] = d + 1;
+  }
+  auto points = gen_gaussian_points<dims>(n, scales, gen);
+  auto tree = kdtree::buildKdTree(points);
+  for (int i = 0; i < 5; ++i) {
+    auto p = points[i];
+    p[0] += 0.5;
+    auto n1 = kdtree::knnWithDistances(tree, points, k, p);
+    auto n2 = simple_knn(points, k, p);
+    BOOST_REQUIRE_EQUAL(n1.size(), n2.size());
+    for (int j = 0; j < n1.size(); ++j) {
+      BOOST_CHECK_EQUAL(n1[j].index, n2[j]);
+      BOOST_CHECK_CLOSE(n1[j].dist, distSquared(points[n2[j]], p), 1e-9);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(random_high_dim) {
+  run_knn_random<64>(2000, 10);
+  run_knn_random<100>(1000, 5);
+}
+
+// correlated points whose variance is mostly off-axis, in `strong` of the dimensions
+template<Size dims>
+std::vector<std::array<double, dims>> correlated_points(int n, int strong, std::mt19937 &gen) {
+  std::array<double, dims> scales;
+  for (int d = 0; d < dims; ++d) {
+    scales[d] = d < strong ? 10 : 0.1;
+  }
+  return gen_correlated_points<dims>(n, scales, 0, gen);
+}
+
+// visited leafes and found exact neighbors of the first `queries` points
+template<typename Tree, Size dims>
+std::tuple<int, int> visited_and_found(const Tree &tree, const std::vector<std::array<double, dims>> &points,
+    int k, int queries) {
+  int visited = 0;
+  int found = 0;
+  for (int i = 0; i < queries; ++i) {
+    auto n1 = kdtree::knn(tree, points, k, points[i]);
+    visited += kdtree::countVisitedLeafes;
+    auto n2 = simple_knn(points, k, points[i]);
+    std::sort(n1.begin(), n1.end());
+    std::sort(n2.begin(), n2.end());
+    std::vector<Size> both;
+    std::set_intersection(n1.begin(), n1.end(), n2.begin(), n2.end(), std::back_inserter(both));
+    found += both.size();
+  }
+  return std::make_tuple(visited, found);
+}
+
+BOOST_AUTO_TEST_CASE(rotated) {
+  constexpr Size dims = 8;
+  const int k = 5, queries = 20;
+  std::mt19937 gen(3);
+  auto points = correlated_points<dims>(4096, 3, gen);
+  auto plain = visited_and_found(kdtree::buildKdTree(points), points, k, queries);
+  auto pca = visited_and_found(
+    kdtree::buildKdTree(points, rotation::pcaRotation(points, 1000, dims, gen)), points, k, queries);
+  auto random = visited_and_found(
+    kdtree::buildKdTree(points, rotation::randomRotation<dims>(gen)), points, k, queries);
+  std::cout << "[visited leafes: plain " << get<0>(plain) << ", pca " << get<0>(pca)
+    << ", random " << get<0>(random) << "]\n";
+  // without dropped coordinates the search stays exact
+  BOOST_CHECK_EQUAL(get<1>(plain), k * queries);
+  BOOST_CHECK_EQUAL(get<1>(pca), k * queries);
+  BOOST_CHECK_EQUAL(get<1>(random), k * queries);
+  // Splits along the principal axes cut the points where they are spread out.
+  // A random rotation of points whose variance is already off-axis leaves it off-axis,
+  // so it is no better than no rotation and worse than pca.
+  BOOST_CHECK(get<0>(pca) < get<0>(plain));
+  BOOST_CHECK(get<0>(pca) < get<0>(random));
+}
+
+BOOST_AUTO_TEST_CASE(rotated_reduced) {
+  constexpr Size dims = 32;
+  constexpr Size keep = 4;
+  const int k = 5, queries = 20;
+  std::mt19937 gen(4);
+  auto points = correlated_points<dims>(4096, keep, gen);
+  auto pca = rotation::pcaRotation(points, 1000, keep, gen);
+  auto full = visited_and_found(kdtree::buildKdTree(points, pca), points, k, queries);
+  // the tree only has the kept dimensions, the candidates are reranked with all dimensions
+  auto reduced = visited_and_found(kdtree::buildKdTree<keep>(points, pca), points, k, queries);
+  std::cout << "[" << keep << " of " << dims << " dimensions: visited leafes " << get<0>(reduced)
+    << ", recall " << get<1>(reduced) << "/" << k * queries
+    << "; zeroed " << dims - keep << " dimensions: visited leafes " << get<0>(full)
+    << ", recall " << get<1>(full) << "/" << k * queries << "]\n";
+  BOOST_CHECK(get<1>(reduced) >= 0.9 * k * queries);
+  BOOST_CHECK(get<0>(reduced) <= get<0>(full));
+}
+
+BOOST_AUTO_TEST_CASE(rotated_keep_all) {
+  constexpr Size dims = 8;
+  std::mt19937 gen(5);
+  auto points = correlated_points<dims>(1000, 3, gen);
+  auto pca = rotation::pcaRotation(points, 1000, dims, gen);
+  // an explicit KEEP of all dimensions is the same tree as no KEEP
+  auto explicitKeep = kdtree::buildKdTree<dims>(points, pca);
+  auto implicitKeep = kdtree::buildKdTree(points, pca);
+  BOOST_CHECK(explicitKeep.tree.elems == implicitKeep.tree.elems);
+  for (int i = 0; i < 10; ++i) {
+    BOOST_CHECK(kdtree::knn(explicitKeep, points, 5, points[i]) == simple_knn(points, 5, points[i]));
+  }
+}
+
 BOOST_AUTO_TEST_CASE(build_huge_tree) {
   auto points = gen_full_grid<9>(5);
   auto tree = kdtree::buildKdTree(points);
@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <tuple>
 #include <queue>
+#include <random>
 
 #define BOOST_TEST_DYN_LINK
 #include <boost/test/unit_test.hpp>
@@ -71,6 +72,77 @@ void run_knn(int pointsPerDim, Real r, Size L) {
   }
 }
 
+// compares the sketch prefiltered knn with the plain knn on the same buckets
+template<Size dims, Size K, Size BITS>
+void run_knn_sketches(int n, Real r, Size L, Real prefilter) {
+  int k = 10;
+  std::mt19937 gen(dims);
+  auto points = gen_low_rank_points<dims>(n, 8, 0.1, gen);
+  auto index = lsh::generate_hashes_with_sketches<dims, K, BITS>(points, r, L);
+  auto hashes = std::make_tuple(get<0>(index), get<1>(index));
+  int found = 0;
+  int total = 0;
+  Size exactUnfiltered = 0;
+  Size exactFiltered = 0;
+  for (int i = 0; i < 50; ++i) {
+    auto p = points[i * (n / 50)];
+    auto n1 = lsh::knn<dims, K>(hashes, points, p, r, k);
+    exactUnfiltered += lsh::countExactDistances;
+    BOOST_CHECK(n1 == (lsh::knn<dims, K, BITS>(index, points, p, r, k, 1.0)));
+    auto n2 = lsh::knn<dims, K, BITS>(index, points, p, r, k, prefilter);
+    exactFiltered += lsh::countExactDistances;
+    std::sort(n1.begin(), n1.end());
+    std::sort(n2.begin(), n2.end());
+    std::vector<Size> both;
+    std::set_intersection(n1.begin(), n1.end(), n2.begin(), n2.end(), std::back_inserter(both));
+    found += both.size();
+    total += n1.size();
+  }
+  std::cout << "[sketch " << BITS << " bits, prefilter " << prefilter << ": "
+    << found << "/" << total << " of the unfiltered neighbors found, "
+    << exactFiltered << " instead of " << exactUnfiltered << " exact distances]\n";
+  BOOST_CHECK(found >= 0.9 * total);
+  BOOST_CHECK(exactFiltered * 4 <= exactUnfiltered);
+}
+
+BOOST_AUTO_TEST_CASE(sketches) {
+  lsh::Sketch<128> s1{{0x0f, 0x1}};
+  lsh::Sketch<128> s2{{0xf0, 0x1}};
+  BOOST_CHECK_EQUAL(lsh::hamming<128>(s1, s2), 8);
+  run_knn_sketches<64, 2, 64>(5000, 20, 10, 0.2);
+  run_knn_sketches<64, 2, 256>(5000, 20, 10, 0.1);
+}
+
+BOOST_AUTO_TEST_CASE(sketches_invalid_prefilter) {
+  std::mt19937 gen(1);
+  auto points = gen_low_rank_points<16>(500, 4, 0.1, gen);
+  auto index = lsh::generate_hashes_with_sketches<16, 2, 64>(points, 20, 4);
+  auto all = lsh::knn<16, 2, 64>(index, points, points[0], 20, 5, 1.0);
+  BOOST_CHECK(all == (lsh::knn<16, 2, 64>(index, points, points[0], 20, 5, 2.0)));
+  BOOST_CHECK(all == (lsh::knn<16, 2, 64>(index, points, points[0], 20, 5, std::nan(""))));
+  BOOST_CHECK_EQUAL((lsh::knn<16, 2, 64>(index, points, points[0], 20, 5, -1.0).size()), all.size());
+}
+
+BOOST_AUTO_TEST_CASE(remove_duplicates) {
+  std::mt19937 gen(2);
+  std::uniform_int_distribution<Size> dist(0, 500);
+  std::vector<Size> ids(3000);
+  for (auto &id : ids) {
+    id = dist(gen);
+  }
+  std::vector<Size> expected;
+  for (auto id : ids) { // first occurrences in order
+    if (std::find(expected.begin(), expected.end(), id) == expected.end()) {
+      expected.push_back(id);
+    }
+  }
+  lsh::remove_duplicates(ids);
+  BOOST_CHECK(ids == expected);
+  std::vector<Size> empty;
+  lsh::remove_duplicates(empty);
+  BOOST_CHECK(empty.empty());
+}
+
 BOOST_AUTO_TEST_CASE(demo) {
   run_knn_minimal<2, 2>(5, 1, 5);
 }
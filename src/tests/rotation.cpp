@@ -0,0 +1,91 @@
+#include <iostream>
+#include <array>
+#include <vector>
+#include <random>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "rotation.hpp"
+#include "tests/common.hpp"
+
+BOOST_AUTO_TEST_SUITE(rotation_tests)
+
+template<Size dims>
+void check_orthonormal(const rotation::Transform<dims> &t) {
+  for (int i = 0; i < dims; ++i) {
+    for (int j = 0; j < dims; ++j) {
+      double dot_product = 0;
+      for (int d = 0; d < dims; ++d) {
+        dot_product += t.rows[i][d] * t.rows[j][d];
+      }
+      BOOST_CHECK_SMALL(dot_product - (i == j ? 1 : 0), 1e-9);
+    }
+  }
+}
+
+// variance decreasing along random directions, centered at 5
+template<Size dims>
+std::vector<std::array<double, dims>> correlated_points(int n, std::mt19937 &gen) {
+  std::array<double, dims> scales;
+  for (int d = 0; d < dims; ++d) {
+    scales[d] = 10.0 / (d + 1);
+  }
+  return gen_correlated_points<dims>(n, scales, 5, gen);
+}
+
+BOOST_AUTO_TEST_CASE(random_rotation) {
+  std::mt19937 gen(1);
+  auto t = rotation::randomRotation<12>(gen);
+  check_orthonormal(t);
+  std::array<double, 12> a{}, b{};
+  a[0] = 1;
+  b[5] = 2;
+  BOOST_CHECK_CLOSE(distSquared(t.apply(a), t.apply(b)), distSquared(a, b), 1e-9);
+}
+
+BOOST_AUTO_TEST_CASE(pca) {
+  std::mt19937 gen(2);
+  auto points = correlated_points<8>(5000, gen);
+  auto t = rotation::pcaRotation(points, 2000, 8, gen);
+  check_orthonormal(t);
+  // the transformed coordinates are uncorrelated and sorted by decreasing variance
+  std::array<std::array<double, 8>, 8> covariance{};
+  for (const auto &p : points) {
+    auto y = t.apply(p);
+    for (int i = 0; i < 8; ++i) {
+      for (int j = 0; j < 8; ++j) {
+        covariance[i][j] += y[i] * y[j] / points.size();
+      }
+    }
+  }
+  for (int i = 0; i < 8; ++i) {
+    for (int j = 0; j < 8; ++j) {
+      if (i != j) {
+        BOOST_CHECK_SMALL(covariance[i][j] / std::sqrt(covariance[i][i] * covariance[j][j]), 0.1);
+      }
+    }
+    if (i > 0) {
+      BOOST_CHECK(covariance[i][i] < covariance[i - 1][i - 1]);
+    }
+  }
+  // rotating the kept coordinates keeps their subspace: the kept rows lie in the span
+  // of the 3 principal axes, i.e. they are orthogonal to all other axes
+  auto reduced = rotation::pcaRotation(points, 2000, 3, gen);
+  auto both = rotation::rotateKept(reduced, gen);
+  check_orthonormal(both);
+  BOOST_CHECK_EQUAL(both.keep, 3);
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 3; j < 8; ++j) {
+      BOOST_CHECK_SMALL(rotation::dot(both.rows[i], reduced.rows[j]), 1e-9);
+    }
+  }
+  // but spreads the variance over them
+  BOOST_CHECK(std::abs(rotation::dot(both.rows[0], reduced.rows[0])) < 1 - 1e-6);
+  // the dropped rows are unchanged
+  for (int i = 3; i < 8; ++i) {
+    BOOST_CHECK_SMALL(rotation::dot(both.rows[i], reduced.rows[i]) - 1, 1e-9);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,141 @@
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "scheduler.hpp"
+
+BOOST_AUTO_TEST_SUITE(scheduler_tests)
+
+BOOST_AUTO_TEST_CASE(thread_pool) {
+  std::atomic<int> sum{0};
+  {
+    scheduler::ThreadPool pool{4};
+    for (int i = 1; i <= 1000; ++i) {
+      pool.submit([&sum, i]{ sum += i; });
+    }
+  }
+  BOOST_CHECK_EQUAL(sum, 500500);
+}
+
+BOOST_AUTO_TEST_CASE(histogram) {
+  scheduler::Histogram h;
+  BOOST_CHECK_EQUAL(h.percentiles().count, 0);
+  std::vector<double> samples;
+  for (int i = 1; i <= 100000; ++i) {
+    samples.push_back(i * 0.37);
+    h.add(i * 0.37);
+  }
+  auto exact = scheduler::percentiles(samples);
+  auto approx = h.percentiles();
+  BOOST_CHECK_EQUAL(approx.count, exact.count);
+  BOOST_CHECK_EQUAL(approx.max, exact.max);
+  // within the width of one bucket
+  BOOST_CHECK_CLOSE(approx.p50, exact.p50, 5);
+  BOOST_CHECK_CLOSE(approx.p90, exact.p90, 5);
+  BOOST_CHECK_CLOSE(approx.p99, exact.p99, 5);
+  // out of range values are counted, not dropped
+  h.add(0);
+  h.add(1e12, 10);
+  BOOST_CHECK_EQUAL(h.percentiles().count, exact.count + 11);
+  BOOST_CHECK_EQUAL(h.percentiles().max, 1e12);
+  h.clear();
+  BOOST_CHECK_EQUAL(h.percentiles().count, 0);
+}
+
+BOOST_AUTO_TEST_CASE(futures_and_callbacks) {
+  std::atomic<size_t> largestBatch{0};
+  scheduler::Options options;
+  options.maxBatchSize = 8;
+  options.maxWait = std::chrono::milliseconds(2);
+  options.threads = 2;
+  std::atomic<int> callbackSum{0};
+  {
+    scheduler::Executor<int, int> executor{[&largestBatch](const std::vector<int> &qs){
+      auto n = largestBatch.load();
+      while (qs.size() > n && !largestBatch.compare_exchange_weak(n, qs.size())) {}
+      std::vector<int> rs;
+      for (auto q : qs) {
+        rs.push_back(q * q);
+      }
+      return rs;
+    }, options};
+    std::vector<std::future<int>> futures;
+    for (int i = 0; i < 100; ++i) {
+      futures.push_back(executor.submit(i));
+      executor.submit(i, [&callbackSum](int r){ callbackSum += r; }, [](std::exception_ptr){});
+    }
+    for (int i = 0; i < 100; ++i) {
+      BOOST_CHECK_EQUAL(futures[i].get(), i * i);
+    }
+    auto report = executor.report();
+    BOOST_CHECK(report.batches >= 200 / 8);
+    BOOST_CHECK(report.queue.count <= 200);
+    BOOST_CHECK(report.queue.p50 <= report.queue.max);
+    BOOST_CHECK_EQUAL(report.failed, 0);
+  }
+  BOOST_CHECK_EQUAL(callbackSum, 328350); // sum of squares 0..99
+  BOOST_CHECK(largestBatch <= 8);
+  BOOST_CHECK(largestBatch > 1);
+}
+
+BOOST_AUTO_TEST_CASE(errors) {
+  scheduler::Executor<int, int> executor{[](const std::vector<int> &) -> std::vector<int> {
+    throw std::runtime_error("batch failed");
+  }};
+  auto f = executor.submit(1);
+  BOOST_CHECK_THROW(f.get(), std::runtime_error);
+  BOOST_CHECK_EQUAL(executor.report().failed, 1);
+
+  // the load generator counts failed queries instead of waiting for them forever
+  auto result = scheduler::runLoad(executor, std::vector<int>{1}, 2, 1000, std::chrono::milliseconds(20));
+  BOOST_CHECK_EQUAL(result.failed, result.queries);
+  BOOST_CHECK_EQUAL(result.latency.count, 0);
+}
+
+BOOST_AUTO_TEST_CASE(wrong_number_of_results) {
+  scheduler::Options options;
+  options.maxBatchSize = 4;
+  options.maxWait = std::chrono::milliseconds(50);
+  scheduler::Executor<int, int> executor{[](const std::vector<int> &qs){
+    return std::vector<int>(qs.begin(), qs.end() - 1); // one result too few
+  }, options};
+  std::vector<std::future<int>> futures;
+  for (int i = 0; i < 4; ++i) {
+    futures.push_back(executor.submit(i));
+  }
+  for (auto &f : futures) {
+    BOOST_CHECK_THROW(f.get(), std::length_error);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(throwing_callbacks) {
+  std::atomic<int> answered{0};
+  {
+    scheduler::Executor<int, int> executor{[](const std::vector<int> &qs){ return qs; }};
+    for (int i = 0; i < 10; ++i) {
+      executor.submit(i, [&answered](int){ ++answered; throw std::runtime_error("callback failed"); },
+        [](std::exception_ptr){});
+    }
+  } // waits for all answers
+  BOOST_CHECK_EQUAL(answered, 10);
+}
+
+BOOST_AUTO_TEST_CASE(load_generator) {
+  scheduler::Options options;
+  options.maxWait = std::chrono::microseconds(200);
+  scheduler::Executor<int, int> executor{[](const std::vector<int> &qs){ return qs; }, options};
+  std::vector<int> queries{1, 2, 3};
+  auto result = scheduler::runLoad(executor, queries, 4, 2000, std::chrono::milliseconds(100));
+  std::cout << "load: " << result.queries << " queries, " << result.throughput << "/s, p99 "
+    << result.latency.p99 << "us\n";
+  BOOST_CHECK(result.queries > 100);
+  BOOST_CHECK_EQUAL(result.latency.count, result.queries);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,71 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "topk.hpp"
+#include "tests/common.hpp"
+
+BOOST_AUTO_TEST_SUITE(topk_tests)
+
+using TopK = topk::TopK<double, Size>;
+
+void check_against_sort(Size k, Size n) {
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<> dist(0, 1);
+  std::vector<double> ds(n);
+  for (auto &d : ds) {
+    d = dist(gen);
+  }
+  TopK nearest{k};
+  for (Size i = 0; i < n; ++i) {
+    nearest.push(ds[i], i);
+  }
+  std::vector<double> expected{ds};
+  std::sort(expected.begin(), expected.end());
+  expected.resize(std::min(k, n));
+  auto result = nearest.sorted();
+  BOOST_REQUIRE_EQUAL(result.size(), expected.size());
+  for (Size i = 0; i < result.size(); ++i) {
+    BOOST_CHECK_EQUAL(result[i].dist, expected[i]);
+    BOOST_CHECK_EQUAL(ds[result[i].index], result[i].dist);
+  }
+  if (n >= k && k > 0) {
+    BOOST_CHECK_EQUAL(nearest.bound(), expected.back());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(sorted_insertion) {
+  check_against_sort(1, 100);
+  check_against_sort(7, 100);
+  check_against_sort(topk::sortedInsertionMaxK, 1000);
+  check_against_sort(10, 5);
+}
+
+BOOST_AUTO_TEST_CASE(heap) {
+  check_against_sort(topk::sortedInsertionMaxK + 1, 1000);
+  check_against_sort(200, 10000);
+  check_against_sort(100, 50);
+}
+
+BOOST_AUTO_TEST_CASE(bound) {
+  TopK nearest{2};
+  BOOST_CHECK(nearest.bound() > 1e300);
+  BOOST_CHECK(nearest.push(3, 0));
+  BOOST_CHECK(nearest.bound() > 1e300);
+  BOOST_CHECK(nearest.push(1, 1));
+  BOOST_CHECK_EQUAL(nearest.bound(), 3);
+  BOOST_CHECK(!nearest.push(3, 2));
+  BOOST_CHECK(nearest.push(2, 3));
+  BOOST_CHECK_EQUAL(nearest.bound(), 2);
+  BOOST_CHECK((nearest.indices() == std::vector<Size>{1, 3}));
+
+  TopK none{0};
+  BOOST_CHECK(!none.push(0, 0));
+  BOOST_CHECK_EQUAL(none.size(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
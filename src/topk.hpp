@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstddef>
+
+namespace topk {
+
+using std::vector;
+using std::size_t;
+
+template<typename Real, typename Index>
+struct Neighbor {
+  Real dist;
+  Index index;
+};
+
+template<typename Real, typename Index>
+inline bool operator<(const Neighbor<Real, Index> &n1, const Neighbor<Real, Index> &n2) {
+  return n1.dist < n2.dist;
+}
+
+// up to this k the candidates are kept sorted by insertion, for larger k a max-heap is used
+constexpr size_t sortedInsertionMaxK = 32;
+
+// Collects the k candidates with the smallest distance.
+//
+// For small k the candidates are kept in a sorted array (best first) and new ones are
+// inserted by shifting the worse ones back, which is cheaper than maintaining a heap.
+// For large k the candidates are kept as a max-heap on the distance.
+// In both cases `bound()` is the distance a new candidate has to beat and costs one load.
+template<typename Real, typename Index>
+class TopK {
+public:
+  using Elem = Neighbor<Real, Index>;
+
+  explicit TopK(size_t k)
+    : k(k),
+      useHeap(k > sortedInsertionMaxK),
+      kth(k == 0 ? -std::numeric_limits<Real>::infinity() : std::numeric_limits<Real>::infinity()) {
+    elems.reserve(k);
+  }
+
+  size_t size() const { return elems.size(); }
+  size_t capacity() const { return k; }
+  bool full() const { return elems.size() >= k; }
+
+  // distance of the current kth best candidate (infinity as long as less than k were collected)
+  Real bound() const { return kth; }
+
+  // returns true if the candidate is (for now) among the k best
+  bool push(Real dist, Index index) {
+    if (!(dist < kth)) {
+      return false;
+    }
+    if (useHeap) {
+      if (full()) {
+        std::pop_heap(elems.begin(), elems.end());
+        elems.back() = Elem{dist, index};
+      } else {
+        elems.push_back(Elem{dist, index});
+      }
+      std::push_heap(elems.begin(), elems.end());
+      if (full()) {
+        kth = elems.front().dist;
+      }
+    } else {
+      if (!full()) {
+        elems.push_back(Elem{dist, index});
+      }
+      auto i = elems.size() - 1;
+      for (; i > 0 && dist < elems[i - 1].dist; --i) {
+        elems[i] = elems[i - 1];
+      }
+      elems[i] = Elem{dist, index};
+      if (full()) {
+        kth = elems.back().dist;
+      }
+    }
+    return true;
+  }
+
+  // the collected candidates sorted best first
+  vector<Elem> sorted() const {
+    vector<Elem> result{elems};
+    if (useHeap) {
+      std::sort_heap(result.begin(), result.end());
+    }
+    return result;
+  }
+
+  // the indices of the collected candidates sorted best first
+  vector<Index> indices() const {
+    vector<Index> result{};
+    result.reserve(elems.size());
+    for (const auto &e : sorted()) {
+      result.push_back(e.index);
+    }
+    return result;
+  }
+
+private:
+  size_t k;
+  bool useHeap;
+  Real kth;
+  vector<Elem> elems;
+};
+
+}